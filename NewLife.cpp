@@ -2,9 +2,13 @@
 #include <fstream>
 #include <algorithm>
 #include <thread>
+#include <atomic>
 #include <chrono>
 
 #include <vector>
+#include <array>
+#include <deque>
+#include <unordered_set>
 #include <string>
 
 #include <numeric>
@@ -48,7 +52,11 @@ const std::string gameSettingsNames[] = {
     "m",
     "k",
     "seed",
-    "probability"
+    "probability",
+    "l",
+    "incremental",
+    "clusters",
+    "history"
 };
 
 enum TypeCell
@@ -72,97 +80,113 @@ struct iField
 {
     virtual void show() = 0;
 };
-struct Field1D
+//      ,   -  coord[d] * strides[d].
+// extents[0] -   , extents[tDimension - 1] -  Y (m).
+template<int tDimension>
+struct Field : iField
 {
-    int n = 0;
+    std::array<int, tDimension> extents = {};
+    std::array<int, tDimension> strides = {};
     vector<Cell> cells;
-    Field1D(int n):n(n), cells(vector<Cell>(n)) {}
-    int getNum(int pos, TypeCell type = alive, int radius = 1) const
+    Field() = default;
+    Field(const std::array<int, tDimension>& extents) : extents(extents)
     {
-        int count = 0;
-        for (int i = pos - radius; i <= pos + radius; i++)
-            if (cells[(i + n) % n].type == type)
-                count++;
-        return count;
-    }
-    Cell& operator[](int i) { return cells[i]; }
-    Cell operator[](int i) const { return cells[i]; } // const   cout
-    friend ostream& operator<<(ostream& out, const Field1D& field)
-    {
-        for (int i = 0; i < field.n; i++)
-            out << field[i];
-        return out;
+        int stride = 1;
+        for (int d = tDimension - 1; d >= 0; --d)
+        {
+            strides[d] = stride;
+            stride *= extents[d];
+        }
+        cells = vector<Cell>(stride, Cell{ env });
     }
-    bool operator==(const Field1D& other)
+    int size() const { return (int)cells.size(); }
+    static int wrap(int pos, int len)
     {
-        for (size_t i = 0; i < cells.size(); ++i)
-            if (!(cells[i].type == other.cells[i].type)) return false;
-        return true;
-    }
-};
-struct Field2D : iField
-{
-    int n = 0;
-    int m = 0;
-    vector<Field1D> cells;
-    Field2D() {}
-    Field2D(int n, int m): n(n), m(m), cells(vector<Field1D>(n, Field1D(m))) {}
-    int getNum(int posX, int posY, TypeCell type = alive, int radius = 1) const
-    {
-        int count = 0;
-        for (int i = posX - radius; i <= posX + radius; i++)
-            count += cells[(i + n) % n].getNum(posY, type, radius);
-        return count;
-    }
-    Field1D& operator[](int i) { return cells[i]; }
-    Field1D operator[](int i) const { return cells[i]; }
-    friend ostream& operator<<(ostream& out, const Field2D& field)
-    {
-        for (int i = 0; i < field.n; i++)
-            out << field[i] << "\n";
-        return out;
+        pos %= len;
+        return pos < 0 ? pos + len : pos;
     }
-    bool operator==(const Field2D& other) // using if n,m is equals
+    //   type   (2 * radius + 1)^tDimension    (  ).
+    //    :           .
+    void countNeighbours(vector<int>& counts, TypeCell type = alive, int radius = 1) const
     {
+        counts.resize(cells.size());
         for (size_t i = 0; i < cells.size(); ++i)
-            if (!(cells[i] == other.cells[i])) return false;
-        return true;
-    }
-    virtual void show() override
-    {
-        std::cout << *this;
-    }
-};
-struct Field3D : iField
-{
-    int n = 0;
-    int m = 0;
-    int k = 0;
-    vector<Field2D> cells;
-    Field3D() = default;
-    Field3D(int n, int m, int k) : n(n), m(m), k(k), cells(vector<Field2D>(k, Field2D(n, m))) {}
+            counts[i] = (cells[i].type == type);
+
+        vector<int> line;
+        for (int d = 0; d < tDimension; ++d)
+        {
+            int len = extents[d];
+            int stride = strides[d];
+            line.resize(len);
+            for (int outer = 0; outer < size(); outer += len * stride)
+            {
+                for (int inner = 0; inner < stride; ++inner)
+                {
+                    int base = outer + inner;
+                    for (int p = 0; p < len; ++p)
+                        line[p] = counts[base + p * stride];
 
-    int getNum(int posZ, int posX, int posY, TypeCell type = alive, int radius = 1) const
+                    int sum = 0;
+                    for (int p = -radius; p <= radius; ++p)
+                        sum += line[wrap(p, len)];
+                    for (int p = 0; p < len; ++p)
+                    {
+                        counts[base + p * stride] = sum;
+                        sum += line[wrap(p + radius + 1, len)] - line[wrap(p - radius, len)];
+                    }
+                }
+            }
+        }
+    }
+    //  func(j)    j  (2 * radius + 1)^tDimension  index,   index.
+    template<class tFunc>
+    void forEachNeighbour(int index, int radius, tFunc func) const
     {
-        int count = 0;
-        for (int i = posZ - radius; i <= posZ + radius; i++)
+        std::array<int, tDimension> coord;
+        std::array<int, tDimension> offset;
+        for (int d = 0; d < tDimension; ++d)
         {
-            count += cells[(i + k) % k].getNum(posX, posY, type, radius);
+            coord[d] = index / strides[d] % extents[d];
+            offset[d] = -radius;
+        }
+        while (true)
+        {
+            int j = 0;
+            for (int d = 0; d < tDimension; ++d)
+                j += wrap(coord[d] + offset[d], extents[d]) * strides[d];
+            func(j);
+
+            int d = tDimension - 1;
+            while (d >= 0 && offset[d] == radius) offset[d--] = -radius;
+            if (d < 0) break;
+            ++offset[d];
         }
-        return count;
     }
-    Field2D& operator[](int i) { return cells[i]; }
-    Field2D operator[](int i) const { return cells[i]; }
-    friend ostream& operator<<(ostream& out, const Field3D& field)
+    Cell& operator[](int i) { return cells[i]; }
+    const Cell& operator[](int i) const { return cells[i]; } // const   cout
+    friend ostream& operator<<(ostream& out, const Field& field)
     {
-        for (int i = 0; i < field.k; i++)
-            out << i << ":\n" << field[i] << "\n";
+        int row = field.extents[tDimension - 1];
+        int plane = tDimension >= 3 ? row * field.extents[tDimension >= 2 ? tDimension - 2 : 0] : field.size();
+        for (int i = 0; i < field.size(); i++)
+        {
+            if (tDimension >= 3 && i % plane == 0)
+            {
+                for (int d = 0; d < tDimension - 2; ++d)
+                    out << i / field.strides[d] % field.extents[d] << ':';
+                out << '\n';
+            }
+            out << field[i];
+            if ((i + 1) % row == 0) out << '\n';
+            if (tDimension >= 3 && (i + 1) % plane == 0) out << '\n';
+        }
         return out;
     }
-    bool operator==(const Field3D& other) // using if n,m,k is equals
+    bool operator==(const Field& other) const // using if extents is equals
     {
         for (size_t i = 0; i < cells.size(); ++i)
-            if (!(cells[i] == other.cells[i])) return false;
+            if (!(cells[i].type == other.cells[i].type)) return false;
         return true;
     }
     virtual void show() override
@@ -170,11 +194,17 @@ struct Field3D : iField
         std::cout << *this;
     }
 };
+using Field1D = Field<1>;
+using Field2D = Field<2>;
+using Field3D = Field<3>;
+using Field4D = Field<4>;
+
 struct GameSettings
 {
     int n = 0;
     int m = 0;
     int k = 0;
+    int l = 0;
 
     int seed = 0; //    
     double probability = 0.0;  //  ,   
@@ -185,6 +215,24 @@ struct GameSettings
     int birth_start = 3; //      birth_end   
     int birth_end = 3;
     int overpopulation = 5; //         
+    int incremental = 0; // 1 -         
+    int clusterPeriod = 0; //       , 0 -   
+    int historySize = 4096; //      , 0 -  
+
+    TypeCell applyRule(TypeCell type, int count) const
+    {
+        if (count <= loneliness || count >= overpopulation) return TypeCell::env;
+        if (count >= birth_start && count <= birth_end) return TypeCell::alive;
+        return type;
+    }
+
+    //       : (n), (n, m), (k, n, m), (l, k, n, m)
+    vector<int> getExtents() const
+    {
+        const int all[] = { l, k, n, m };
+        if (dimension == 1) return { n };
+        return vector<int>(std::end(all) - dimension, std::end(all));
+    }
 };
 
 class GameLoader
@@ -226,6 +274,10 @@ public:
         std::string prob = std::to_string(gs.probability);
         std::replace(prob.begin(), prob.end(), '.', ',');
         output << gameSettingsNames[5] + '=' << prob << '\n';
+        output << gameSettingsNames[6] + '=' << gs.l << '\n';
+        output << gameSettingsNames[7] + '=' << gs.incremental << '\n';
+        output << gameSettingsNames[8] + '=' << gs.clusterPeriod << '\n';
+        output << gameSettingsNames[9] + '=' << gs.historySize << '\n';
 
         output.close();
     }
@@ -239,181 +291,702 @@ private:
         else if (param == gameSettingsNames[3]) gs.k = (int)value;
         else if (param == gameSettingsNames[4]) gs.seed = (int)value;
         else if (param == gameSettingsNames[5]) gs.probability = value;
+        else if (param == gameSettingsNames[6]) gs.l = (int)value;
+        else if (param == gameSettingsNames[7]) gs.incremental = (int)value;
+        else if (param == gameSettingsNames[8]) gs.clusterPeriod = (int)value;
+        else if (param == gameSettingsNames[9]) gs.historySize = (int)value;
     }
 };
 
-struct iGame : public GameSettings, Subject<GameEvent>
+//       incremental.
+//       candidates - ,    ,
+//    O(changes * (2r+1)^d),   O( ).
+// :   candidates  -     . candidates  
+//  apply  ,  flip       ,    flip
+// (  ,   )  .
+template<int tDimension>
+struct IncrementalCounter
 {
-    virtual void setGame(double p, int s = 0) = 0;
-    virtual void runGame(int numIt) = 0;
-    virtual ~iGame() { ; }
+    int radius = 0;
+    vector<int> counts;
+    vector<char> queued; //     candidates
+    vector<int> candidates;
+    vector<int> changes; // ,      
+
+    void reset(const Field<tDimension>& field, int r)
+    {
+        radius = r;
+        field.countNeighbours(counts, TypeCell::alive, radius);
+        queued.assign(field.size(), 1);
+        candidates.resize(field.size());
+        iota(candidates.begin(), candidates.end(), 0);
+        changes.clear();
+    }
+    // candidates    apply,    ,     
+    void evaluate(const Field<tDimension>& field, const GameSettings& rules)
+    {
+        changes.clear();
+        for (int i : candidates)
+            if (rules.applyRule(field[i].type, counts[i]) != field[i].type)
+                changes.push_back(i);
+    }
+    void apply(Field<tDimension>& field)
+    {
+        for (int i : candidates) queued[i] = 0;
+        candidates.clear();
+        for (int i : changes)
+            flip(field, i);
+    }
+    void flip(Field<tDimension>& field, int i)
+    {
+        int delta = (field[i].type == TypeCell::alive) ? -1 : 1;
+        field[i].type = (delta > 0) ? TypeCell::alive : TypeCell::env;
+        field.forEachNeighbour(i, radius, [&](int j) {
+            counts[j] += delta;
+            if (!queued[j]) { queued[j] = 1; candidates.push_back(j); }
+        });
+    }
 };
 
-struct Game2D : iGame
+struct GenerationDelta
 {
-    Field2D field;
-    Field2D fieldNext;
-    Field2D fieldLoop;
-    Field2D fieldLoopNext;
-    unsigned long long stepCount = 0;
-    Game2D() { dimension = 2; }
-    Game2D(int n, int m){
-        this->n = n;
-        this->m = m;
-        dimension = 2;
-        field = fieldNext = fieldLoop = fieldLoopNext = Field2D(n, m);
+    vector<int> births;
+    vector<int> deaths;
+};
+
+//            O().
+//   keyframePeriod     ,        .
+template<int tDimension>
+struct GenerationHistory
+{
+    static const int keyframePeriod = 256;
+    vector<GenerationDelta> deltas; // deltas[(head + i) % size]  firstGeneration + i   
+    int head = 0;
+    int count = 0;
+    unsigned long long firstGeneration = 0;
+    unsigned long long generation = 0; // ,    field
+    std::deque<std::pair<unsigned long long, vector<bool>>> keyframes; //   
+
+    void reset(const Field<tDimension>& field, int capacity)
+    {
+        deltas.resize(max(capacity, 0));
+        head = count = 0;
+        firstGeneration = generation = 0;
+        keyframes.clear();
+        if (capacity > 0) addKeyframe(field);
     }
-    virtual void setGame(double p, int s = 0) override
+    unsigned long long lastGeneration() const { return firstGeneration + count; }
+    const GenerationDelta& at(unsigned long long gen) const //  gen -> gen + 1
     {
-        probability = p;
-        seed = s;
-        field = fieldNext = fieldLoopNext = Field2D(n, m);
-        vector<int> tmp(n * m);
-        iota(tmp.begin(), tmp.end(), 0);
-        shuffle(tmp.begin(), tmp.end(), std::mt19937(seed));
-        for (int i = 0; i < (int)(p * n * m + 0.5); i++)
+        return deltas[(head + (int)(gen - firstGeneration)) % deltas.size()];
+    }
+    //    generation -> generation + 1;   generation (  ) 
+    GenerationDelta& push()
+    {
+        count = (int)(generation - firstGeneration);
+        while (!keyframes.empty() && keyframes.back().first > generation) keyframes.pop_back();
+        if (count == (int)deltas.size())
         {
-            int x = tmp[i] / m;
-            int y = tmp[i] % m;
-            field[x][y].type = TypeCell::alive;
+            head = (head + 1) % deltas.size();
+            --count;
+            ++firstGeneration;
+            while (!keyframes.empty() && keyframes.front().first < firstGeneration) keyframes.pop_front();
         }
-        fieldLoop = field;
+        GenerationDelta& delta = deltas[(head + count) % deltas.size()];
+        delta.births.clear();
+        delta.deaths.clear();
+        ++count;
+        ++generation;
+        return delta;
     }
-    void runGame(int numIt) override
+    void addKeyframe(const Field<tDimension>& field)
     {
-        for (int it = 0; it < numIt; it++)
+        if (generation % keyframePeriod != 0) return;
+        vector<bool> cells(field.size());
+        for (int i = 0; i < field.size(); ++i)
+            cells[i] = (field[i].type == TypeCell::alive);
+        keyframes.emplace_back(generation, std::move(cells));
+    }
+    //    ,     from  to
+    size_t cost(unsigned long long from, unsigned long long to) const
+    {
+        size_t result = 0;
+        for (unsigned long long gen = min(from, to); gen < max(from, to); ++gen)
+            result += at(gen).births.size() + at(gen).deaths.size();
+        return result;
+    }
+    const std::pair<unsigned long long, vector<bool>>* nearestKeyframe(unsigned long long gen) const
+    {
+        const std::pair<unsigned long long, vector<bool>>* nearest = nullptr;
+        for (const auto& keyframe : keyframes)
+            if (!nearest || max(keyframe.first, gen) - min(keyframe.first, gen) < max(nearest->first, gen) - min(nearest->first, gen))
+                nearest = &keyframe;
+        return nearest;
+    }
+};
+
+struct Cluster
+{
+    int size = 0;
+    vector<int> boxMin; //         extents;
+    vector<int> boxMax; // boxMax[d] >= extents[d],      
+    int period = 0; //      : 0 -  , 1 -  
+    bool isOscillating() const { return period > 1; }
+};
+struct ClusterReport
+{
+    unsigned long long generation = 0;
+    vector<Cluster> clusters;
+};
+
+//  [0, size)  threads     : func(thread, begin, end).
+template<class tFunc>
+void parallelFor(int size, int threads, tFunc func)
+{
+    int chunk = (size + threads - 1) / threads;
+    vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t)
+        workers.emplace_back(func, t, min(size, t * chunk), min(size, (t + 1) * chunk));
+    func(0, 0, min(size, chunk));
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+//           radius,    .
+//  union-find:       compare_exchange,
+//       -    ""  :
+//            ,  unite  .
+//     ,     O( )      .
+template<int tDimension>
+struct ClusterAnalyzer
+{
+    static const int historySize = 16;
+    static const int cellsPerThread = 1 << 14;
+    vector<std::atomic<int>> parent;
+    vector<int> clusterId; //    
+    vector<int> label; //      
+    vector<char> isChangedCell; //   changes
+    vector<std::atomic<char>> isNearChange; //  ,    (  radius)  
+    std::deque<std::pair<unsigned long long, std::unordered_set<unsigned long long>>> history; //    , [0] - 
+
+    // changes - ,     generation - 1 -> generation, nullptr -  
+    ClusterReport analyze(const Field<tDimension>& field, int radius, unsigned long long generation, const vector<int>* changes)
+    {
+        int size = field.size();
+        int threads = max(1, min((int)std::thread::hardware_concurrency(), size / cellsPerThread));
+        if ((int)parent.size() != size)
+        {
+            parent = vector<std::atomic<int>>(size);
+            isNearChange = vector<std::atomic<char>>(size);
+            isChangedCell.assign(size, 0);
+        }
+        clusterId.resize(size);
+        label.resize(size);
+        if (changes)
+            for (int i : *changes) isChangedCell[i] = 1;
+
+        vector<std::array<int, tDimension>> offsets;
+        vector<int> flatOffsets;
+        std::array<int, tDimension> offset;
+        offset.fill(-radius);
+        while (true)
         {
-            for (int i = 0; i < n; i++)
+            int d = 0;
+            while (d < tDimension && offset[d] == 0) ++d;
+            if (d < tDimension && offset[d] < 0)
             {
-                for (int j = 0; j < m; j++)
-                {
-                    int count = field.getNum(i, j);
-                    fieldNext[i][j].type = field[i][j].type;
-                    if (count <= loneliness || count >= overpopulation) fieldNext[i][j].type = TypeCell::env;
-                    else if (count >= birth_start && count <= birth_end) fieldNext[i][j].type = TypeCell::alive;
+                offsets.push_back(offset);
+                int flat = 0;
+                for (int i = 0; i < tDimension; ++i)
+                    flat += offset[i] * field.strides[i];
+                flatOffsets.push_back(flat);
+            }
+            d = tDimension - 1;
+            while (d >= 0 && offset[d] == radius) offset[d--] = -radius;
+            if (d < 0) break;
+            ++offset[d];
+        }
 
-                    if (stepCount % 2 == 1)
+        parallelFor(size, threads, [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i)
+            {
+                parent[i].store(i, std::memory_order_relaxed);
+                isNearChange[i].store(0, std::memory_order_relaxed);
+            }
+        });
+        //       :   (i, j)   ,
+        //     ,   
+        parallelFor(size, threads, [&](int, int begin, int end) {
+            std::array<int, tDimension> coord = toCoord(field, begin);
+            for (int i = begin; i < end; ++i, nextCoord(field, coord))
+            {
+                bool isAlive = (field[i].type == TypeCell::alive);
+                bool isChanged = changes && isChangedCell[i];
+                if (!isAlive && !isChanged) continue;
+                if (isAlive && isChanged) isNearChange[i].store(1, std::memory_order_relaxed);
+                bool isInner = true; //     ,    
+                for (int d = 0; d < tDimension; ++d)
+                    isInner = isInner && coord[d] >= radius && coord[d] + radius < field.extents[d];
+                for (size_t o = 0; o < offsets.size(); ++o)
+                {
+                    int j = i + flatOffsets[o];
+                    if (!isInner)
                     {
-                        int count = fieldLoop.getNum(i, j);
-                        fieldLoopNext[i][j].type = fieldLoop[i][j].type;
-                        if (count <= loneliness || count >= overpopulation) fieldLoopNext[i][j].type = TypeCell::env;
-                        else if (count >= birth_start && count <= birth_end) fieldLoopNext[i][j].type = TypeCell::alive;
+                        j = 0;
+                        for (int d = 0; d < tDimension; ++d)
+                            j += Field<tDimension>::wrap(coord[d] + offsets[o][d], field.extents[d]) * field.strides[d];
                     }
+                    bool isAliveNeighbour = (field[j].type == TypeCell::alive);
+                    if (isAlive && isAliveNeighbour
+                        && parent[i].load(std::memory_order_relaxed) != parent[j].load(std::memory_order_relaxed))
+                        unite(i, j);
+                    if (!changes) continue;
+                    if (isAlive && isChangedCell[j]) isNearChange[i].store(1, std::memory_order_relaxed);
+                    if (isChanged && isAliveNeighbour) isNearChange[j].store(1, std::memory_order_relaxed);
                 }
             }
+        });
+
+        //      :      ,  
+        vector<int> firstId(threads + 1, 0);
+        parallelFor(size, threads, [&](int t, int begin, int end) {
+            for (int i = begin; i < end; ++i)
+                firstId[t + 1] += (field[i].type == TypeCell::alive && parent[i].load(std::memory_order_relaxed) == i);
+        });
+        std::partial_sum(firstId.begin(), firstId.end(), firstId.begin());
+        int clusterCount = firstId[threads];
+        parallelFor(size, threads, [&](int t, int begin, int end) {
+            int id = firstId[t];
+            for (int i = begin; i < end; ++i)
+                if (field[i].type == TypeCell::alive && parent[i].load(std::memory_order_relaxed) == i)
+                    clusterId[i] = id++;
+        });
 
-            int aliveCount = 0;
-            for (int i = 0; i < n; i++)
+        struct Accumulator
+        {
+            int size = 0;
+            std::array<int, tDimension> boxMin;
+            std::array<int, tDimension> boxMax;
+            unsigned long long hash = 0;
+            bool isChanged = false;
+        };
+        vector<vector<Accumulator>> partial(threads, vector<Accumulator>(clusterCount));
+        parallelFor(size, threads, [&](int t, int begin, int end) {
+            vector<Accumulator>& acc = partial[t];
+            std::array<int, tDimension> coord = toCoord(field, begin);
+            for (int i = begin; i < end; ++i, nextCoord(field, coord))
             {
-                for (int j = 0; j < m; j++)
+                if (field[i].type != TypeCell::alive) continue;
+                label[i] = clusterId[findRoot(i)];
+                Accumulator& a = acc[label[i]];
+                for (int d = 0; d < tDimension; ++d)
                 {
-                    aliveCount += (field[i][j].type == TypeCell::alive);
+                    a.boxMin[d] = (a.size == 0) ? coord[d] : min(a.boxMin[d], coord[d]);
+                    a.boxMax[d] = (a.size == 0) ? coord[d] : max(a.boxMax[d], coord[d]);
                 }
+                a.hash += mix(i);
+                a.isChanged = a.isChanged || isNearChange[i].load(std::memory_order_relaxed);
+                ++a.size;
             }
-            if (aliveCount == 0) { sendEvent(EMPTY_FIELD); return; }
-            else if (aliveCount == n * m) { sendEvent(FULL_FIELD); return; }
+        });
 
-            if (field == fieldNext) { sendEvent(SINGLE_LOOP); return; }
-            field = fieldNext;
+        ClusterReport report;
+        report.generation = generation;
+        report.clusters.resize(clusterCount);
+        vector<unsigned long long> hashes(clusterCount, 0);
+        vector<char> isChanged(clusterCount, 0); //      ,          
+        for (int c = 0; c < clusterCount; ++c)
+        {
+            Cluster& cluster = report.clusters[c];
+            cluster.boxMin.assign(tDimension, 0);
+            cluster.boxMax.assign(tDimension, 0);
+            bool isEmpty = true;
+            for (int t = 0; t < threads; ++t)
+            {
+                const Accumulator& a = partial[t][c];
+                if (a.size == 0) continue;
+                for (int d = 0; d < tDimension; ++d)
+                {
+                    cluster.boxMin[d] = isEmpty ? a.boxMin[d] : min(cluster.boxMin[d], a.boxMin[d]);
+                    cluster.boxMax[d] = isEmpty ? a.boxMax[d] : max(cluster.boxMax[d], a.boxMax[d]);
+                }
+                isEmpty = false;
+                cluster.size += a.size;
+                hashes[c] += a.hash;
+                isChanged[c] = isChanged[c] || a.isChanged;
+            }
+        }
+        wrapBoxes(field, radius, report, threads);
 
-            if (field == fieldLoop) { sendEvent(MULTI_LOOP); return; }
-            if (stepCount % 2 == 1)
-                fieldLoop = fieldLoopNext;
+        if (changes)
+            for (int i : *changes) isChangedCell[i] = 0;
 
-            ++stepCount;
+        std::unordered_set<unsigned long long> current;
+        for (int c = 0; c < clusterCount; ++c)
+        {
+            Cluster& cluster = report.clusters[c];
+            if (changes && !isChanged[c]) cluster.period = 1;
+            for (size_t h = 0; h < history.size() && cluster.period == 0; ++h)
+                if (history[h].first < generation && history[h].second.count(hashes[c]))
+                    cluster.period = (int)(generation - history[h].first);
+            current.insert(hashes[c]);
+        }
+        if (history.empty() || history.front().first != generation)
+        {
+            history.emplace_front(generation, std::move(current));
+            if ((int)history.size() > historySize) history.pop_back();
         }
+        return report;
     }
+    void clearHistory() { history.clear(); }
+
+private:
+    //    d      (  [min, max]   radius),
+    //    - ,      ,    .
+    //        .
+    void wrapBoxes(const Field<tDimension>& field, int radius, ClusterReport& report, int threads)
+    {
+        int clusterCount = (int)report.clusters.size();
+        vector<int> slot(clusterCount * tDimension, -1);
+        int occupiedSize = 0;
+        for (int c = 0; c < clusterCount; ++c)
+        {
+            const Cluster& cluster = report.clusters[c];
+            for (int d = 0; d < tDimension; ++d)
+            {
+                if (field.extents[d] - (cluster.boxMax[d] - cluster.boxMin[d] + 1) >= radius) continue;
+                slot[c * tDimension + d] = occupiedSize;
+                occupiedSize += field.extents[d];
+            }
+        }
+        if (occupiedSize == 0) return;
+
+        vector<std::atomic<char>> occupied(occupiedSize);
+        parallelFor(field.size(), threads, [&](int, int begin, int end) {
+            std::array<int, tDimension> coord = toCoord(field, begin);
+            for (int i = begin; i < end; ++i, nextCoord(field, coord))
+            {
+                if (field[i].type != TypeCell::alive) continue;
+                for (int d = 0; d < tDimension; ++d)
+                {
+                    int s = slot[label[i] * tDimension + d];
+                    if (s >= 0) occupied[s + coord[d]].store(1, std::memory_order_relaxed);
+                }
+            }
+        });
+
+        for (int c = 0; c < clusterCount; ++c)
+        {
+            for (int d = 0; d < tDimension; ++d)
+            {
+                int s = slot[c * tDimension + d];
+                if (s < 0) continue;
+                int len = field.extents[d];
+                int last = len - 1; //      
+                while (!occupied[s + last].load(std::memory_order_relaxed)) --last;
+                int gap = 0;
+                int start = 0;
+                bool isFirst = true;
+                for (int p = 0, empty = 0; p < len; ++p)
+                {
+                    if (!occupied[s + p].load(std::memory_order_relaxed)) { ++empty; continue; }
+                    if (isFirst) empty += len - 1 - last; //       
+                    if (empty > gap) { gap = empty; start = p; }
+                    empty = 0;
+                    isFirst = false;
+                }
+                report.clusters[c].boxMin[d] = start;
+                report.clusters[c].boxMax[d] = start + len - gap - 1;
+            }
+        }
+    }
+    static std::array<int, tDimension> toCoord(const Field<tDimension>& field, int index)
+    {
+        std::array<int, tDimension> coord;
+        for (int d = 0; d < tDimension; ++d)
+            coord[d] = index / field.strides[d] % field.extents[d];
+        return coord;
+    }
+    static void nextCoord(const Field<tDimension>& field, std::array<int, tDimension>& coord)
+    {
+        int d = tDimension - 1;
+        while (d >= 0 && ++coord[d] == field.extents[d]) coord[d--] = 0;
+    }
+    int findRoot(int x)
+    {
+        int p = parent[x].load(std::memory_order_relaxed);
+        while (p != x)
+        {
+            int gp = parent[p].load(std::memory_order_relaxed);
+            if (gp != p) parent[x].store(gp, std::memory_order_relaxed); // gp -   x
+            x = p;
+            p = gp;
+        }
+        return x;
+    }
+    void unite(int a, int b)
+    {
+        while (true)
+        {
+            a = findRoot(a);
+            b = findRoot(b);
+            if (a == b) return;
+            if (a > b) std::swap(a, b);
+            int expected = b;
+            if (parent[b].compare_exchange_weak(expected, a)) return;
+        }
+    }
+    static unsigned long long mix(unsigned long long x) // splitmix64
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+};
+
+struct iGame : public GameSettings, Subject<GameEvent>, Subject<ClusterReport>
+{
+    using Subject<GameEvent>::sendEvent;
+    using Subject<GameEvent>::addObserver;
+    using Subject<GameEvent>::deleteObserver;
+    using Subject<ClusterReport>::sendEvent;
+    using Subject<ClusterReport>::addObserver;
+    using Subject<ClusterReport>::deleteObserver;
+
+    virtual void setGame(double p, int s = 0) = 0;
+    virtual void runGame(int numIt) = 0;
+    virtual void analyzeClusters() = 0; //    Subject<ClusterReport>
+    virtual bool stepBack() = 0;
+    virtual bool jumpToGeneration(unsigned long long generation) = 0;
+    virtual unsigned long long getFirstGeneration() const = 0;
+    virtual unsigned long long getLastGeneration() const = 0;
+    virtual ~iGame() { ; }
 };
-struct Game3D : public iGame
+
+template<int tDimension>
+struct Game : iGame
 {
-    Field3D field;
-    Field3D fieldNext;
-    Field3D fieldLoop;
-    Field3D fieldLoopNext;
+    Field<tDimension> field;
+    Field<tDimension> fieldNext;
+    Field<tDimension> fieldLoop;
+    Field<tDimension> fieldLoopNext;
+    vector<int> counts;
+    IncrementalCounter<tDimension> counter;
+    IncrementalCounter<tDimension> counterLoop;
+    ClusterAnalyzer<tDimension> clusterAnalyzer;
+    GenerationHistory<tDimension> history;
+    vector<int> changes; // ,     
+    bool isChangesKnown = false;
+    bool isCounterReady = false;
+    bool isLoopStale = false; // field ,     
+    int aliveCount = 0;
+    int loopDiffCount = 0; //  ,   field  fieldLoop 
     unsigned long long stepCount = 0;
-    Game3D() { dimension = 3; }
-    Game3D(int n, int m, int k) {
-        this->n = n;
-        this->m = m;
-        this->k = k;
-        dimension = 3;
-        field = fieldNext = Field3D(n, m, k);
-        fieldLoop = fieldLoopNext = field;
-    }
+    Game() { dimension = tDimension; }
     virtual void setGame(double p, int s = 0) override
     {
         stepCount = 0;
         probability = p;
         seed = s;
-        field = fieldNext = fieldLoopNext = Field3D(n, m, k);
-        vector<int> tmp(n * m * k);
+        vector<int> ext = getExtents();
+        std::array<int, tDimension> extents;
+        std::copy(ext.begin(), ext.end(), extents.begin());
+        field = fieldNext = fieldLoopNext = Field<tDimension>(extents);
+        vector<int> tmp(field.size());
         iota(tmp.begin(), tmp.end(), 0);
         shuffle(tmp.begin(), tmp.end(), std::mt19937(seed));
-        for (int i = 0; i < (int)(p * n * m * k + 0.5); i++)
-        {
-            int z = tmp[i] / (n * m);
-            int x = tmp[i] % (n * m) / m;
-            int y = tmp[i] % (n * m) % m;
-            field[z][x][y].type = TypeCell::alive;
-        }
+        for (int i = 0; i < (int)(p * field.size() + 0.5); i++)
+            field[tmp[i]].type = TypeCell::alive;
+        restart();
+    }
+    //       field (,   field )
+    void restart()
+    {
+        stepCount = 0;
         fieldLoop = field;
+        isCounterReady = false;
+        isLoopStale = false;
+        isChangesKnown = false;
+        clusterAnalyzer.clearHistory();
+        history.reset(field, historySize);
     }
     void runGame(int numIt) override
     {
+        if (incremental) { runGameIncremental(numIt); return; }
+        isCounterReady = false;
+        if (isLoopStale) { fieldLoop = field; isLoopStale = false; }
         for (int it = 0; it < numIt; it++)
         {
-            for (int l = 0; l < k; l++)
-            {
-                for (int i = 0; i < n; i++)
-                {
-                    for (int j = 0; j < m; j++)
-                    {
-                        int count = field.getNum(l, i, j, TypeCell::alive, radius);
-                        fieldNext[l][i][j].type = field[l][i][j].type;
-                        if (count <= loneliness || count >= overpopulation) fieldNext[l][i][j].type = TypeCell::env;
-                        else if (count >= birth_start && count <= birth_end) fieldNext[l][i][j].type = TypeCell::alive;
+            step(field, fieldNext);
+            if (stepCount % 2 == 1)
+                step(fieldLoop, fieldLoopNext);
 
-                        if (stepCount % 2 == 1)
-                        {
-                            count = fieldLoop.getNum(l, i, j, TypeCell::alive, radius);
-                            fieldLoopNext[l][i][j].type = fieldLoop[l][i][j].type;
-                            if (count <= loneliness || count >= overpopulation) fieldLoopNext[l][i][j].type = TypeCell::env;
-                            else if (count >= birth_start && count <= birth_end) fieldLoopNext[l][i][j].type = TypeCell::alive;
-                        }
-                    }
-                }
-            }
-            double frac = getAliveFraction();
-            double epsilon = 0.0001;
-            if (frac >= 0.0 - epsilon && frac <= 0.0 + epsilon) { sendEvent(EMPTY_FIELD); return; }
-            if (frac >= 1.0 - epsilon && frac <= 1.0 + epsilon) { sendEvent(FULL_FIELD);  return; }
+            int aliveCount = getAliveCount();
+            if (aliveCount == 0) { sendEvent(EMPTY_FIELD); return; }
+            else if (aliveCount == field.size()) { sendEvent(FULL_FIELD); return; }
 
             if (field == fieldNext) { sendEvent(SINGLE_LOOP); return; }
+            changes.clear();
+            for (int i = 0; i < field.size(); ++i)
+                if (field[i].type != fieldNext[i].type) changes.push_back(i);
+            isChangesKnown = true;
+            recordHistory(changes);
             field = fieldNext;
+            if (historySize > 0) history.addKeyframe(field);
 
             if (field == fieldLoop) { sendEvent(MULTI_LOOP); return; }
             if (stepCount % 2 == 1)
                 fieldLoop = fieldLoopNext;
-            
+
             ++stepCount;
+            if (clusterPeriod > 0 && stepCount % clusterPeriod == 0)
+                analyzeClusters();
         }
     }
-    double getAliveFraction()
+    //  ,  runGame,  field  fieldLoop          
+    void runGameIncremental(int numIt)
     {
-        int aliveCount = 0;
-        for (int z = 0; z < field.k; ++z)
+        if (isLoopStale)
         {
-            for (int x = 0; x < field.n; ++x)
-            {
-                for (int y = 0; y < field.m; ++y)
-                {
-                    aliveCount += (field[z][x][y].type == TypeCell::alive);
-                }
-            }
+            fieldLoop = field;
+            counterLoop = counter;
+            loopDiffCount = 0;
+            isLoopStale = false;
+        }
+        if (!isCounterReady || counter.radius != radius)
+        {
+            counter.reset(field, radius);
+            counterLoop.reset(fieldLoop, radius);
+            aliveCount = getAliveCount();
+            loopDiffCount = 0;
+            for (int i = 0; i < field.size(); ++i)
+                loopDiffCount += (field[i].type != fieldLoop[i].type);
+            isCounterReady = true;
         }
-        return double(aliveCount) / (double(field.k) * double(field.m) * double(field.n));
+        for (int it = 0; it < numIt; it++)
+        {
+            counter.evaluate(field, *this);
+            if (stepCount % 2 == 1)
+                counterLoop.evaluate(fieldLoop, *this);
+
+            if (aliveCount == 0) { sendEvent(EMPTY_FIELD); return; }
+            else if (aliveCount == field.size()) { sendEvent(FULL_FIELD); return; }
+
+            if (counter.changes.empty()) { sendEvent(SINGLE_LOOP); return; }
+            for (int i : counter.changes)
+                aliveCount += (field[i].type == TypeCell::alive) ? -1 : 1;
+            changes = counter.changes;
+            isChangesKnown = true;
+            recordHistory(changes);
+            applyChanges(counter, field, fieldLoop);
+            if (historySize > 0) history.addKeyframe(field);
+
+            if (loopDiffCount == 0) { sendEvent(MULTI_LOOP); return; }
+            if (stepCount % 2 == 1)
+                applyChanges(counterLoop, fieldLoop, field);
+
+            ++stepCount;
+            if (clusterPeriod > 0 && stepCount % clusterPeriod == 0)
+                analyzeClusters();
+        }
+    }
+    virtual void analyzeClusters() override
+    {
+        sendEvent(clusterAnalyzer.analyze(field, radius, stepCount, isChangesKnown ? &changes : nullptr));
+    }
+    virtual bool stepBack() override
+    {
+        return history.generation > 0 && jumpToGeneration(history.generation - 1);
+    }
+    //    :        ,  
+    virtual bool jumpToGeneration(unsigned long long target) override
+    {
+        if (historySize <= 0 || target < history.firstGeneration || target > history.lastGeneration()) return false;
+
+        unsigned long long current = history.generation;
+        const auto* keyframe = history.nearestKeyframe(target);
+        if (keyframe && field.size() + history.cost(keyframe->first, target) < history.cost(current, target))
+        {
+            for (int i = 0; i < field.size(); ++i)
+                field[i].type = keyframe->second[i] ? TypeCell::alive : TypeCell::env;
+            current = keyframe->first;
+            isCounterReady = false;
+        }
+        for (; current > target; --current)
+        {
+            const GenerationDelta& delta = history.at(current - 1);
+            for (int i : delta.births) setCell(i, TypeCell::env);
+            for (int i : delta.deaths) setCell(i, TypeCell::alive);
+        }
+        for (; current < target; ++current)
+        {
+            const GenerationDelta& delta = history.at(current);
+            for (int i : delta.births) setCell(i, TypeCell::alive);
+            for (int i : delta.deaths) setCell(i, TypeCell::env);
+        }
+
+        isChangesKnown = target > history.firstGeneration;
+        if (isChangesKnown)
+        {
+            const GenerationDelta& delta = history.at(target - 1);
+            changes = delta.births;
+            changes.insert(changes.end(), delta.deaths.begin(), delta.deaths.end());
+        }
+        history.generation = target;
+        stepCount = target;
+        isLoopStale = true;
+        clusterAnalyzer.clearHistory();
+        return true;
+    }
+    virtual unsigned long long getFirstGeneration() const override { return history.firstGeneration; }
+    virtual unsigned long long getLastGeneration() const override { return history.lastGeneration(); }
+    void setCell(int i, TypeCell type)
+    {
+        if (field[i].type == type) return;
+        if (isCounterReady)
+        {
+            aliveCount += (type == TypeCell::alive) ? 1 : -1;
+            counter.flip(field, i);
+        }
+        else field[i].type = type;
+    }
+    // changes - ,      field   
+    void recordHistory(const vector<int>& changes)
+    {
+        if (historySize <= 0) return;
+        GenerationDelta& delta = history.push();
+        for (int i : changes)
+            (field[i].type == TypeCell::alive ? delta.deaths : delta.births).push_back(i);
+    }
+    void applyChanges(IncrementalCounter<tDimension>& changed, Field<tDimension>& target, const Field<tDimension>& other)
+    {
+        for (int i : changed.changes)
+            loopDiffCount += (target[i].type == other[i].type) ? 1 : -1;
+        changed.apply(target);
+    }
+    void step(const Field<tDimension>& from, Field<tDimension>& to)
+    {
+        from.countNeighbours(counts, TypeCell::alive, radius);
+        for (int i = 0; i < from.size(); i++)
+            to[i].type = applyRule(from[i].type, counts[i]);
+    }
+    int getAliveCount() const
+    {
+        int aliveCount = 0;
+        for (int i = 0; i < field.size(); ++i)
+            aliveCount += (field[i].type == TypeCell::alive);
+        return aliveCount;
+    }
+    double getAliveFraction() const
+    {
+        return double(getAliveCount()) / double(field.size());
     }
 };
+using Game1D = Game<1>;
+using Game2D = Game<2>;
+using Game3D = Game<3>;
+using Game4D = Game<4>;
 
 void doExperiment(Game3D& g3d, const Field3D& baseField)
 {
@@ -428,6 +1001,7 @@ void doExperiment(Game3D& g3d, const Field3D& baseField)
                     for (int op = be + 1; op <= 27; ++op)
                     {
                         g3d.field = baseField;
+                        g3d.restart();
 
                         g3d.radius = r;
                         g3d.loneliness = ll;
@@ -449,7 +1023,7 @@ void doExperiment(Game3D& g3d, const Field3D& baseField)
     }
 };
 
-struct View : Observer<GameEvent>
+struct View : Observer<GameEvent>, Observer<ClusterReport>
 {
 private:
     iGame* game = nullptr;
@@ -457,6 +1031,8 @@ private:
     GameState currentState = SETUP;
     std::string overMessage = { 0 };
     int frameRate = 500;
+    ClusterReport clusterReport;
+    bool hasClusterReport = false;
 
 public:
     View() = default;
@@ -508,6 +1084,7 @@ private:
     {
         system("cls");
         overMessage.clear();
+        hasClusterReport = false;
 
         GameSettings settings;
         char answer;
@@ -529,6 +1106,7 @@ private:
 
         game->runGame(1);
         field->show();
+        if (hasClusterReport) showClusterReport(false);
         std::this_thread::sleep_for(std::chrono::milliseconds(frameRate));
 
         int pressedKey = getPressedKey();
@@ -540,14 +1118,44 @@ private:
         std::cout << ":\n"
             "R,    SETUP,\n"
             "S,   \n"
+            "C,     \n"
+            "B,     \n"
+            "J,      \n"
             "   ,  .\n";
         int key = 0;
         while ((key = getPressedKey()) == -1);
         if (key == 'r' || key == 170) currentState = SETUP; // 170 - ''
+        else if (key == 'c' || key == 225) { game->analyzeClusters(); if (hasClusterReport) showClusterReport(true); } // 225 - ''
+        else if (key == 'b' || key == 168) { if (game->stepBack()) showField(); else std::cout << "     .\n"; } // 168 - ''
+        else if (key == 'j' || key == 174) jumpToGeneration(); // 174 - ''
         else if (key == 's' || key == 235) { saveGameSettings(); currentState = RUN; } // 235 - ''
         else currentState = RUN;
     }
 
+    void showField()
+    {
+        system("cls");
+        field->show();
+    }
+
+    void jumpToGeneration()
+    {
+        unsigned long long generation = 0;
+        std::cout << "   (" << game->getFirstGeneration() << " - " << game->getLastGeneration() << "): ";
+        std::cin >> generation;
+        if (std::cin.fail())
+        {
+            cin.clear();
+            cin.ignore(1000, '\n');
+        }
+        else if (game->jumpToGeneration(generation))
+        {
+            showField();
+            return;
+        }
+        std::cout << "    .\n";
+    }
+
     void onOver()
     {
         char answer = 0;
@@ -585,17 +1193,19 @@ private:
             isOk = true;
             std::cout << "   (dimenshion): ";
             std::cin >> gs.dimension;
-            std::cout << "   (n, m, k),  dimenshion = 2,  k - : ";
-            std::cin >> gs.n >> gs.m >> gs.k;
+            int* extents[] = { &gs.n, &gs.m, &gs.k, &gs.l };
+            std::cout << "   ( dimenshion  n, m, k, l): ";
+            for (int d = 0; d < gs.dimension && d < 4; ++d)
+                std::cin >> *extents[d];
             std::cout << "    (p, s): ";
             std::cin >> gs.probability >> gs.seed;
 
-            if (gs.dimension != 2 && gs.dimension != 3)
+            if (gs.dimension < 1 || gs.dimension > 4)
             {
                 std::cout << "  ." << '\n';
                 isOk = false;
             }
-            else if (gs.n == 0 || gs.m == 0 || (gs.k == 0 && gs.dimension == 3))
+            else if (gs.n <= 0 || (gs.m <= 0 && gs.dimension >= 2) || (gs.k <= 0 && gs.dimension >= 3) || (gs.l <= 0 && gs.dimension == 4))
             {
                 std::cout << "  ." << '\n';
                 isOk = false;
@@ -612,22 +1222,46 @@ private:
 
     void applyGameSettings(GameSettings gs)
     {
-        if (gs.dimension != 2 && gs.dimension != 3) throw(std::string(",  ."));
-        if (gs.dimension == 2)
+        if (gs.dimension < 1 || gs.dimension > 4) throw(std::string(",  ."));
+        delete game;
+        if (gs.dimension == 1) createGame<1>();
+        else if (gs.dimension == 2) createGame<2>();
+        else if (gs.dimension == 3) createGame<3>();
+        else if (gs.dimension == 4) createGame<4>();
+        *static_cast<GameSettings*>(game) = gs; // set user settings
+        game->setGame(gs.probability, gs.seed);
+        game->addObserver(static_cast<Observer<GameEvent>&>(*this));
+        game->addObserver(static_cast<Observer<ClusterReport>&>(*this));
+    }
+
+    void showClusterReport(bool isDetailed)
+    {
+        int maxSize = 0;
+        int oscillating = 0;
+        for (const Cluster& cluster : clusterReport.clusters)
         {
-            Game2D* pGame = new Game2D();
-            field = &(pGame->field);
-            game = pGame;
+            maxSize = max(maxSize, cluster.size);
+            oscillating += cluster.isOscillating();
         }
-        else if (gs.dimension == 3)
+        std::cout << " " << clusterReport.generation << ":  " << clusterReport.clusters.size()
+            << ",  " << maxSize << ",  " << oscillating << '\n';
+        if (!isDetailed) return;
+        for (size_t i = 0; i < clusterReport.clusters.size(); ++i)
         {
-            Game3D* pGame = new Game3D();
-            field = &(pGame->field);
-            game = pGame;
+            const Cluster& cluster = clusterReport.clusters[i];
+            std::cout << i << ":  " << cluster.size << ",  ";
+            for (size_t d = 0; d < cluster.boxMin.size(); ++d)
+                std::cout << (d ? " x " : "") << '[' << cluster.boxMin[d] << ".." << cluster.boxMax[d] << ']';
+            std::cout << ",  " << cluster.period << '\n';
         }
-        *static_cast<GameSettings*>(game) = gs; // set user settings
-        game->setGame(gs.probability, gs.seed);
-        game->addObserver(*this);
+    }
+
+    template<int tDimension>
+    void createGame()
+    {
+        Game<tDimension>* pGame = new Game<tDimension>();
+        field = &(pGame->field);
+        game = pGame;
     }
 
     void saveGameSettings()
@@ -684,6 +1318,12 @@ private:
             break;
         }
     }
+
+    virtual void newEvent(ClusterReport report) override
+    {
+        clusterReport = report;
+        hasClusterReport = true;
+    }
 };
 
 int main()